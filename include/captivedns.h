@@ -0,0 +1,36 @@
+#ifndef GULINUX_CAPTIVE_DNS_H
+#define GULINUX_CAPTIVE_DNS_H
+
+#include <IPAddress.h>
+#include <lwip/udp.h>
+#include "captivednsresponse.h"
+
+#ifndef WIFIMANAGER_CAPTIVE_DNS_PORT
+#define WIFIMANAGER_CAPTIVE_DNS_PORT 53
+#endif
+
+namespace GuLinux {
+/**
+ * Captive portal DNS responder for access point mode, answering every A query with the access point ip address.
+ * Queries are handled directly in the lwIP receive callback, without queuing events to another task.
+ * Replies are written to a single pbuf allocated in start() and reused for every query, so answering
+ * doesn't allocate; the query pbuf itself comes from the WiFi driver.
+ * start() and stop() run on the lwIP thread as well, so they never overlap with a query being answered.
+ */
+class CaptiveDNSServer {
+public:
+    ~CaptiveDNSServer() { stop(); }
+    bool start(const IPAddress &ipAddress, uint16_t port=WIFIMANAGER_CAPTIVE_DNS_PORT);
+    void stop();
+private:
+    static constexpr uint16_t ReplySize = WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE + CaptiveDNSResponse::AnswerSize;
+    udp_pcb *_pcb = nullptr;
+    pbuf *_reply = nullptr;
+    void *_replyPayload = nullptr;
+    CaptiveDNSResponder _responder;
+
+    void release();
+    static void onPacket(void *arg, udp_pcb *pcb, pbuf *packet, const ip_addr_t *address, u16_t port);
+};
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef GULINUX_CAPTIVE_DNS_RESPONSE_H
+#define GULINUX_CAPTIVE_DNS_RESPONSE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#ifndef WIFIMANAGER_CAPTIVE_DNS_TTL
+#define WIFIMANAGER_CAPTIVE_DNS_TTL 60
+#endif
+
+// Queries larger than this are dropped (a single question never needs more).
+#ifndef WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE
+#define WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE 512
+#endif
+
+// Clients tracked by the rate limiter. Arduino's WiFi.softAP accepts 4 stations by default and ESP-IDF
+// at most 10, so every connected client keeps its own slot. Slots used in the current window are never
+// replaced: queries from sources beyond this many are dropped until a slot goes idle.
+#ifndef WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS
+#define WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS 16
+#endif
+
+// Queries answered per second for each client, extra queries from the same client are dropped.
+// A portal detection probe is a handful of A/AAAA lookups, so this leaves room for retries,
+// while a flooding client can't use up the budget of the other ones.
+#ifndef WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS
+#define WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS 16
+#endif
+
+// Queries answered per second over all clients, as a backstop when many sources query at once.
+#ifndef WIFIMANAGER_CAPTIVE_DNS_MAX_QPS
+#define WIFIMANAGER_CAPTIVE_DNS_MAX_QPS 128
+#endif
+
+namespace GuLinux {
+/**
+ * Builds captive portal DNS responses: A queries are answered with a fixed ip address, other query types get an empty answer.
+ * The answer record is prepared once in setAddress(), build() copies header and question from the query and appends it.
+ * Doesn't depend on Arduino or lwIP, so it can be tested on the host.
+ */
+class CaptiveDNSResponse {
+public:
+    static constexpr size_t AnswerSize = 16;
+    void setAddress(const uint8_t address[4]);
+
+    /**
+     * Builds the response for `query` into `response`.
+     * Returns the response size, or 0 if the query should be dropped.
+     * A `responseSize` of `queryLength + AnswerSize` is always enough.
+     */
+    size_t build(const uint8_t *query, size_t queryLength, uint8_t *response, size_t responseSize) const;
+private:
+    uint8_t _answer[AnswerSize] = {0};
+};
+
+/**
+ * Per client and global query budget, over one second windows.
+ * When all slots are in use, the least recently seen client is replaced, unless it was seen in the current window.
+ */
+class CaptiveDNSRateLimiter {
+public:
+    bool allow(uint32_t address, uint32_t now);
+    void reset();
+private:
+    uint32_t _windowStart = 0;
+    uint16_t _windowQueries = 0;
+    struct Client {
+        uint32_t address;
+        uint32_t windowStart;
+        uint32_t lastSeen;
+        uint16_t queries;
+        bool used;
+    };
+    Client _clients[WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS] = {};
+};
+
+/**
+ * Rate limits and answers a single query: everything the UDP transport needs to do between receiving a query and sending the reply.
+ */
+class CaptiveDNSResponder {
+public:
+    void setAddress(const uint8_t address[4]);
+
+    /**
+     * Builds the reply to `query` from `client` into `reply`.
+     * Returns the reply size, or 0 if the query should be dropped.
+     */
+    size_t handle(const uint8_t *query, size_t queryLength, uint32_t client, uint32_t now, uint8_t *reply, size_t replySize);
+private:
+    CaptiveDNSResponse _response;
+    CaptiveDNSRateLimiter _rateLimiter;
+};
+}
+#endif
@@ -9,16 +9,19 @@
 #include <validation.h>
 
 #include <queue>
+#include <memory>
 
 
 
 namespace GuLinux {
+class CaptiveDNSServer;
 
 class WiFiManager {
 public:
     static WiFiManager &Instance;
     enum Status { Idle, Connecting, Station, AccessPoint, Error };
     WiFiManager();
+    ~WiFiManager();
     void setup(WiFiSettings *wifiSettings);
     
     void reconnect();
@@ -58,6 +61,7 @@ private:
     GuLinux::WiFiSettings *wifiSettings;
     AsyncWiFiMulti wifiMulti;
     Status _status;
+    std::unique_ptr<CaptiveDNSServer> captiveDNS;
     void connect();
 
     void onConnected(const AsyncWiFiMulti::ApSettings &apSettings);
@@ -0,0 +1,90 @@
+#include "captivedns.h"
+#include <ArduinoLog.h>
+#include <lwip/priv/tcpip_priv.h>
+#include <functional>
+
+#define LOG_SCOPE "CaptiveDNSServer:"
+
+namespace {
+    struct TCPIPCall {
+        tcpip_api_call_data call;
+        const std::function<err_t()> *function;
+    };
+
+    err_t runTCPIPCall(tcpip_api_call_data *call) {
+        return (*reinterpret_cast<TCPIPCall*>(call)->function)();
+    }
+
+    // lwIP raw API functions must run on the lwIP thread
+    err_t onTCPIPThread(const std::function<err_t()> &function) {
+        TCPIPCall call{{}, &function};
+        return tcpip_api_call(runTCPIPCall, &call.call);
+    }
+}
+
+bool GuLinux::CaptiveDNSServer::start(const IPAddress &ipAddress, uint16_t port) {
+    stop();
+    uint8_t address[4] = {ipAddress[0], ipAddress[1], ipAddress[2], ipAddress[3]};
+    err_t result = onTCPIPThread([this, &address, port]() {
+        _responder.setAddress(address);
+        _reply = pbuf_alloc(PBUF_TRANSPORT, ReplySize, PBUF_RAM);
+        _pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+        if(!_reply || !_pcb) {
+            release();
+            return static_cast<err_t>(ERR_MEM);
+        }
+        _replyPayload = _reply->payload;
+        udp_recv(_pcb, &CaptiveDNSServer::onPacket, this);
+        err_t bindResult = udp_bind(_pcb, IP4_ADDR_ANY, port);
+        if(bindResult != ERR_OK) {
+            release();
+        }
+        return bindResult;
+    });
+    if(result != ERR_OK) {
+        Log.errorln(LOG_SCOPE "Unable to listen on port %d, error %d", port, result);
+        return false;
+    }
+    Log.infoln(LOG_SCOPE "Answering DNS queries on port %d with ip address %s", port, ipAddress.toString().c_str());
+    return true;
+}
+
+void GuLinux::CaptiveDNSServer::stop() {
+    if(!_pcb) {
+        return;
+    }
+    onTCPIPThread([this]() {
+        release();
+        return static_cast<err_t>(ERR_OK);
+    });
+    Log.infoln(LOG_SCOPE "stopped");
+}
+
+void GuLinux::CaptiveDNSServer::release() {
+    if(_pcb) {
+        udp_remove(_pcb);
+        _pcb = nullptr;
+    }
+    if(_reply) {
+        pbuf_free(_reply);
+        _reply = nullptr;
+    }
+}
+
+void GuLinux::CaptiveDNSServer::onPacket(void *arg, udp_pcb *pcb, pbuf *packet, const ip_addr_t *address, u16_t port) {
+    auto server = static_cast<CaptiveDNSServer*>(arg);
+    pbuf *reply = server->_reply;
+    // Queries from the WiFi driver fit in a single pbuf, chained packets are dropped rather than copied.
+    // The reply pbuf is still referenced while a previous reply waits for ARP resolution, in that case the query is dropped.
+    if(packet->len == packet->tot_len && reply->ref == 1) {
+        // udp_sendto prepends the protocol headers in place, rewind the payload to where the reply starts
+        reply->payload = server->_replyPayload;
+        size_t length = server->_responder.handle(static_cast<const uint8_t*>(packet->payload), packet->len,
+            ip4_addr_get_u32(ip_2_ip4(address)), millis(), static_cast<uint8_t*>(reply->payload), ReplySize);
+        if(length > 0) {
+            reply->len = reply->tot_len = length;
+            udp_sendto(pcb, reply, address, port);
+        }
+    }
+    pbuf_free(packet);
+}
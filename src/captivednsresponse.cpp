@@ -0,0 +1,125 @@
+#include "captivednsresponse.h"
+#include <cstring>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_QR_FLAG 0x80
+#define DNS_AA_FLAG 0x04
+#define DNS_RD_FLAG 0x01
+#define DNS_OPCODE_MASK 0x78
+#define DNS_LABEL_POINTER_MASK 0xC0
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+
+namespace {
+    uint16_t readUInt16(const uint8_t *data) {
+        return (data[0] << 8) | data[1];
+    }
+
+    void writeUInt16(uint8_t *data, uint16_t value) {
+        data[0] = value >> 8;
+        data[1] = value & 0xFF;
+    }
+}
+
+void GuLinux::CaptiveDNSResponse::setAddress(const uint8_t address[4]) {
+    // Name: pointer to the question name, always at the end of the header
+    _answer[0] = DNS_LABEL_POINTER_MASK;
+    _answer[1] = DNS_HEADER_SIZE;
+    writeUInt16(_answer + 2, DNS_TYPE_A);
+    writeUInt16(_answer + 4, DNS_CLASS_IN);
+    writeUInt16(_answer + 6, static_cast<uint32_t>(WIFIMANAGER_CAPTIVE_DNS_TTL) >> 16);
+    writeUInt16(_answer + 8, static_cast<uint32_t>(WIFIMANAGER_CAPTIVE_DNS_TTL) & 0xFFFF);
+    writeUInt16(_answer + 10, 4);
+    memcpy(_answer + 12, address, 4);
+}
+
+size_t GuLinux::CaptiveDNSResponse::build(const uint8_t *query, size_t queryLength, uint8_t *response, size_t responseSize) const {
+    if(queryLength < DNS_HEADER_SIZE || (query[2] & DNS_QR_FLAG) || (query[2] & DNS_OPCODE_MASK) || readUInt16(query + 4) != 1) {
+        return 0;
+    }
+    size_t position = DNS_HEADER_SIZE;
+    while(position < queryLength && query[position] != 0) {
+        if(query[position] & DNS_LABEL_POINTER_MASK) {
+            return 0;
+        }
+        position += query[position] + 1;
+    }
+    // Terminating zero label, followed by type and class
+    size_t questionEnd = position + 5;
+    if(questionEnd > queryLength) {
+        return 0;
+    }
+    bool answerA = readUInt16(query + position + 1) == DNS_TYPE_A && readUInt16(query + position + 3) == DNS_CLASS_IN;
+    size_t length = questionEnd + (answerA ? AnswerSize : 0);
+    if(length > responseSize) {
+        return 0;
+    }
+
+    // Header and question are echoed back, additional records (i.e. EDNS) are dropped
+    memcpy(response, query, questionEnd);
+    response[2] = DNS_QR_FLAG | DNS_AA_FLAG | (query[2] & DNS_RD_FLAG);
+    response[3] = 0;
+    writeUInt16(response + 6, answerA ? 1 : 0);
+    writeUInt16(response + 8, 0);
+    writeUInt16(response + 10, 0);
+    if(answerA) {
+        memcpy(response + questionEnd, _answer, AnswerSize);
+    }
+    return length;
+}
+
+bool GuLinux::CaptiveDNSRateLimiter::allow(uint32_t address, uint32_t now) {
+    Client *client = nullptr;
+    Client *replace = nullptr;
+    for(auto &entry: _clients) {
+        if(entry.used && entry.address == address) {
+            client = &entry;
+            break;
+        }
+        if(!replace || (replace->used && (!entry.used || now - entry.lastSeen > now - replace->lastSeen))) {
+            replace = &entry;
+        }
+    }
+    if(!client) {
+        if(replace->used && now - replace->lastSeen < 1000) {
+            return false;
+        }
+        client = replace;
+        *client = {address, now, now, 0, true};
+    }
+    client->lastSeen = now;
+    if(now - client->windowStart >= 1000) {
+        client->windowStart = now;
+        client->queries = 0;
+    }
+    if(now - _windowStart >= 1000) {
+        _windowStart = now;
+        _windowQueries = 0;
+    }
+    if(client->queries >= WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS || _windowQueries >= WIFIMANAGER_CAPTIVE_DNS_MAX_QPS) {
+        return false;
+    }
+    client->queries++;
+    _windowQueries++;
+    return true;
+}
+
+void GuLinux::CaptiveDNSRateLimiter::reset() {
+    _windowStart = 0;
+    _windowQueries = 0;
+    for(auto &entry: _clients) {
+        entry = {};
+    }
+}
+
+void GuLinux::CaptiveDNSResponder::setAddress(const uint8_t address[4]) {
+    _response.setAddress(address);
+    _rateLimiter.reset();
+}
+
+size_t GuLinux::CaptiveDNSResponder::handle(const uint8_t *query, size_t queryLength, uint32_t client, uint32_t now, uint8_t *reply, size_t replySize) {
+    if(queryLength > WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE || !_rateLimiter.allow(client, now)) {
+        return 0;
+    }
+    return _response.build(query, queryLength, reply, replySize);
+}
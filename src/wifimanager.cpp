@@ -3,6 +3,11 @@
 #include <WiFi.h>
 #include <jsonwebresponse.h>
 #include <webvalidation.h>
+#include "captivedns.h"
+
+#ifndef WIFIMANAGER_CAPTIVE_DNS
+#define WIFIMANAGER_CAPTIVE_DNS 1
+#endif
 
 #define LOG_SCOPE "WiFiManager:"
 
@@ -12,6 +17,8 @@ GuLinux::WiFiManager &GuLinux::WiFiManager::Instance = *new GuLinux::WiFiManager
 
 GuLinux::WiFiManager::WiFiManager() : _status{Status::Idle} {}
 
+GuLinux::WiFiManager::~WiFiManager() = default;
+
 
 
 void GuLinux::WiFiManager::setup(WiFiSettings *wifiSettings) {
@@ -43,10 +50,21 @@ void GuLinux::WiFiManager::setApMode() {
             wifiSettings->apConfiguration().essid, WiFi.softAPIP().toString().c_str());
     WiFi.softAP(wifiSettings->apConfiguration().essid, 
         wifiSettings->apConfiguration().open() ? nullptr : wifiSettings->apConfiguration().psk);
+#if WIFIMANAGER_CAPTIVE_DNS
+    if(!captiveDNS) {
+        captiveDNS = std::make_unique<CaptiveDNSServer>();
+    }
+    if(!captiveDNS->start(WiFi.softAPIP())) {
+        Log.errorln(LOG_SCOPE "Unable to start captive portal DNS, clients may not detect the configuration page");
+    }
+#endif
 }
 
 void GuLinux::WiFiManager::onConnected(const AsyncWiFiMulti::ApSettings &apSettings) {
     Log.infoln(LOG_SCOPE "Connected to WiFi `%s`, ip address: %s", WiFi.SSID().c_str(), WiFi.localIP().toString().c_str());
+    if(captiveDNS) {
+        captiveDNS->stop();
+    }
     WiFi.softAPdisconnect(false);
     WiFi.mode(WIFI_STA);
     _status = Status::Station;
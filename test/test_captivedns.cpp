@@ -0,0 +1,259 @@
+#include "commons.h"
+
+#if !defined(ARDUINO)
+#include "captivednsresponse.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace GuLinux;
+using Packet = std::vector<uint8_t>;
+
+namespace {
+    const uint8_t softAPAddress[4] = {192, 168, 4, 1};
+    const size_t ednsRecordSize = 11;
+
+    Packet makeQuery(const std::string &name, uint16_t type, bool edns=false) {
+        Packet query{0xBE, 0xEF, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, static_cast<uint8_t>(edns ? 1 : 0)};
+        size_t start = 0;
+        while(start < name.size()) {
+            size_t end = name.find('.', start);
+            if(end == std::string::npos) {
+                end = name.size();
+            }
+            query.push_back(end - start);
+            query.insert(query.end(), name.begin() + start, name.begin() + end);
+            start = end + 1;
+        }
+        query.insert(query.end(), {0, static_cast<uint8_t>(type >> 8), static_cast<uint8_t>(type & 0xFF), 0, 1});
+        if(edns) {
+            query.insert(query.end(), {0, 0, 41, 0x10, 0, 0, 0, 0, 0, 0, 0});
+        }
+        return query;
+    }
+
+    uint16_t readUInt16(const Packet &packet, size_t offset) {
+        return (packet[offset] << 8) | packet[offset + 1];
+    }
+}
+
+// Serves CaptiveDNSResponder over a loopback UDP socket like CaptiveDNSServer does over lwIP, with a fake clock for the rate limiter
+class CaptiveDNSLoopback : public testing::Test {
+protected:
+    void SetUp() override {
+        responder.setAddress(softAPAddress);
+        server = openSocket();
+        client = openSocket();
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+        socklen_t addressLength = sizeof(serverAddress);
+        ASSERT_EQ(getsockname(server, reinterpret_cast<sockaddr*>(&serverAddress), &addressLength), 0);
+    }
+
+    void TearDown() override {
+        close(server);
+        close(client);
+    }
+
+    // Returns the reply received by the client, or an empty packet if the server dropped the query
+    Packet exchange(const Packet &query) {
+        EXPECT_EQ(sendto(client, query.data(), query.size(), 0, reinterpret_cast<sockaddr*>(&serverAddress), sizeof(serverAddress)),
+            static_cast<ssize_t>(query.size()));
+        uint8_t packet[WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE + 1];
+        sockaddr_in source{};
+        socklen_t sourceLength = sizeof(source);
+        ssize_t received = recvfrom(server, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&source), &sourceLength);
+        EXPECT_GT(received, 0);
+        if(received <= 0) {
+            return {};
+        }
+        uint8_t reply[WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE + CaptiveDNSResponse::AnswerSize];
+        size_t length = responder.handle(packet, received, source.sin_addr.s_addr, now, reply, sizeof(reply));
+        if(length == 0) {
+            return {};
+        }
+        EXPECT_EQ(sendto(server, reply, length, 0, reinterpret_cast<sockaddr*>(&source), sourceLength), static_cast<ssize_t>(length));
+        Packet answer(length + 1);
+        received = recv(client, answer.data(), answer.size(), 0);
+        EXPECT_EQ(received, static_cast<ssize_t>(length));
+        answer.resize(received > 0 ? received : 0);
+        return answer;
+    }
+
+    CaptiveDNSResponder responder;
+    uint32_t now = 0;
+private:
+    int server = -1;
+    int client = -1;
+    sockaddr_in serverAddress{};
+
+    static int openSocket() {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        timeval timeout{1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return fd;
+    }
+};
+
+TEST_F(CaptiveDNSLoopback, AnswersAQueryWithSoftAPAddress) {
+    Packet query = makeQuery("connectivitycheck.gstatic.com", 1);
+    Packet reply = exchange(query);
+    ASSERT_EQ(reply.size(), query.size() + CaptiveDNSResponse::AnswerSize);
+    EXPECT_EQ(readUInt16(reply, 0), 0xBEEF);
+    // QR, AA, and RD echoed from the query; NOERROR
+    EXPECT_EQ(reply[2], 0x85);
+    EXPECT_EQ(reply[3] & 0x0F, 0);
+    EXPECT_EQ(readUInt16(reply, 4), 1);
+    EXPECT_EQ(readUInt16(reply, 6), 1);
+    EXPECT_EQ(readUInt16(reply, 8), 0);
+    EXPECT_EQ(readUInt16(reply, 10), 0);
+    EXPECT_TRUE(std::equal(query.begin() + 12, query.end(), reply.begin() + 12));
+
+    size_t answer = query.size();
+    EXPECT_EQ(readUInt16(reply, answer), 0xC00C);
+    EXPECT_EQ(readUInt16(reply, answer + 2), 1);
+    EXPECT_EQ(readUInt16(reply, answer + 4), 1);
+    EXPECT_EQ((readUInt16(reply, answer + 6) << 16) | readUInt16(reply, answer + 8), WIFIMANAGER_CAPTIVE_DNS_TTL);
+    EXPECT_EQ(readUInt16(reply, answer + 10), 4);
+    EXPECT_TRUE(std::equal(softAPAddress, softAPAddress + 4, reply.begin() + answer + 12));
+}
+
+TEST_F(CaptiveDNSLoopback, AAAAQueryGetsEmptyAnswer) {
+    Packet query = makeQuery("captive.apple.com", 28);
+    Packet reply = exchange(query);
+    ASSERT_EQ(reply.size(), query.size());
+    EXPECT_EQ(reply[2] & 0x80, 0x80);
+    EXPECT_EQ(reply[3] & 0x0F, 0);
+    EXPECT_EQ(readUInt16(reply, 4), 1);
+    EXPECT_EQ(readUInt16(reply, 6), 0);
+}
+
+TEST_F(CaptiveDNSLoopback, StripsEDNSRecord) {
+    Packet query = makeQuery("example.com", 1, true);
+    Packet reply = exchange(query);
+    ASSERT_EQ(reply.size(), query.size() - ednsRecordSize + CaptiveDNSResponse::AnswerSize);
+    EXPECT_EQ(readUInt16(reply, 6), 1);
+    EXPECT_EQ(readUInt16(reply, 10), 0);
+    EXPECT_EQ(readUInt16(reply, query.size() - ednsRecordSize), 0xC00C);
+}
+
+TEST_F(CaptiveDNSLoopback, DropsMalformedQueries) {
+    Packet query = makeQuery("example.com", 1);
+
+    EXPECT_TRUE(exchange(Packet(query.begin(), query.begin() + 8)).empty());
+    EXPECT_TRUE(exchange(Packet(query.begin(), query.end() - 1)).empty());
+
+    Packet response = query;
+    response[2] |= 0x80;
+    EXPECT_TRUE(exchange(response).empty());
+
+    Packet noQuestions = query;
+    noQuestions[5] = 0;
+    EXPECT_TRUE(exchange(noQuestions).empty());
+
+    Packet twoQuestions = query;
+    twoQuestions[5] = 2;
+    EXPECT_TRUE(exchange(twoQuestions).empty());
+
+    Packet compressed(query.begin(), query.begin() + 12);
+    compressed.insert(compressed.end(), {0xC0, 0x0C, 0, 1, 0, 1});
+    EXPECT_TRUE(exchange(compressed).empty());
+
+    Packet oversized = query;
+    oversized.resize(WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE + 1);
+    EXPECT_TRUE(exchange(oversized).empty());
+
+    Packet labelOverrun = query;
+    labelOverrun[12] = 60;
+    EXPECT_TRUE(exchange(labelOverrun).empty());
+}
+
+TEST_F(CaptiveDNSLoopback, ThrottlesFloodingClient) {
+    Packet query = makeQuery("example.com", 1);
+    for(int i=0; i<WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS; i++) {
+        EXPECT_FALSE(exchange(query).empty());
+    }
+    EXPECT_TRUE(exchange(query).empty());
+    now += 999;
+    EXPECT_TRUE(exchange(query).empty());
+    now += 1;
+    EXPECT_FALSE(exchange(query).empty());
+}
+
+TEST(CaptiveDNSRateLimiter, FloodingClientDoesNotStarveOthers) {
+    CaptiveDNSRateLimiter rateLimiter;
+    for(int i=0; i<WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS * 10; i++) {
+        rateLimiter.allow(1, 0);
+    }
+    EXPECT_FALSE(rateLimiter.allow(1, 0));
+    for(uint32_t client=2; client<WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS + 1; client++) {
+        EXPECT_TRUE(rateLimiter.allow(client, 10));
+    }
+    EXPECT_FALSE(rateLimiter.allow(1, 20));
+}
+
+TEST(CaptiveDNSRateLimiter, KeepsClientsSeenInCurrentWindow) {
+    CaptiveDNSRateLimiter rateLimiter;
+    for(uint32_t client=1; client<=WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS; client++) {
+        while(rateLimiter.allow(client, client));
+    }
+    // Table is full and every client is active: new sources are dropped, throttled clients stay throttled
+    EXPECT_FALSE(rateLimiter.allow(1000, 100));
+    EXPECT_FALSE(rateLimiter.allow(WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS, 100));
+    // Client 1 has been idle for a whole window, its slot goes to the new source
+    EXPECT_TRUE(rateLimiter.allow(1000, 1001));
+    EXPECT_FALSE(rateLimiter.allow(1001, 1001));
+}
+
+TEST(CaptiveDNSRateLimiter, GlobalBudget) {
+    CaptiveDNSRateLimiter rateLimiter;
+    int allowed = 0;
+    for(uint32_t client=1; client<=WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS; client++) {
+        for(int i=0; i<WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS; i++) {
+            allowed += rateLimiter.allow(client, 0) ? 1 : 0;
+        }
+    }
+    EXPECT_EQ(allowed, std::min(WIFIMANAGER_CAPTIVE_DNS_MAX_QPS, WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS * WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENT_QPS));
+    EXPECT_TRUE(rateLimiter.allow(WIFIMANAGER_CAPTIVE_DNS_MAX_CLIENTS, 1000));
+}
+
+TEST(CaptiveDNSBenchmark, BuilderThroughput) {
+    CaptiveDNSResponse response;
+    response.setAddress(softAPAddress);
+    Packet query = makeQuery("connectivitycheck.gstatic.com", 1, true);
+    uint8_t reply[WIFIMANAGER_CAPTIVE_DNS_MAX_PACKET_SIZE + CaptiveDNSResponse::AnswerSize];
+    const int queries = 1000000;
+    size_t total = 0;
+    auto started = std::chrono::steady_clock::now();
+    for(int i=0; i<queries; i++) {
+        query[1] = i;
+        total += response.build(query.data(), query.size(), reply, sizeof(reply));
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    EXPECT_EQ(total, queries * (query.size() - ednsRecordSize + CaptiveDNSResponse::AnswerSize));
+    RecordProperty("queriesPerSecond", std::to_string(static_cast<long>(queries / elapsed.count())));
+}
+
+TEST_F(CaptiveDNSLoopback, LoopbackThroughput) {
+    Packet query = makeQuery("connectivitycheck.gstatic.com", 1, true);
+    const int queries = 20000;
+    int answered = 0;
+    auto started = std::chrono::steady_clock::now();
+    for(int i=0; i<queries; i++) {
+        // One query per rate limiter window, so that only the transport and the builder are measured
+        now += 1000;
+        answered += exchange(query).empty() ? 0 : 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    EXPECT_EQ(answered, queries);
+    RecordProperty("queriesPerSecond", std::to_string(static_cast<long>(queries / elapsed.count())));
+}
+#endif